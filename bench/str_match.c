@@ -0,0 +1,108 @@
+// Compares string_matcher against searching for each pattern separately, the
+// way you would with only string_view_eq and slicing. Usage: ./a.out
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define STR_IMPLEMENTATION
+#include "../str.h"
+
+#define TEXT_LINES  4096
+#define LINE_LENGTH 120
+
+static unsigned long long rng_state = 0x9e3779b97f4a7c15ull;
+
+static unsigned rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (unsigned)rng_state;
+}
+
+static void random_word(string *s, isize length) {
+    for(isize i = 0; i < length; ++i)
+        string_push(s, 'a' + rng() % 26);
+}
+
+static double seconds(void) {
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static isize naive_count(string_view *patterns, isize count, string_view line) {
+    isize found = 0;
+    for(isize p = 0; p < count; ++p) {
+        for(isize i = 0; i + patterns[p].length <= line.length; ++i) {
+            string_view here = string_view_slice(line, i,
+                    i + patterns[p].length);
+            if(string_view_eq(here, patterns[p])) found += 1;
+        }
+    }
+    return found;
+}
+
+static void run(isize count, string_view *lines) {
+    string words;
+    string_init(&words);
+    isize *begin = malloc(sizeof(isize) * (count + 1));
+    for(isize p = 0; p < count; ++p) {
+        begin[p] = words.length;
+        random_word(&words, 4 + rng() % 9);
+    }
+    begin[count] = words.length;
+    string_view *patterns = malloc(sizeof(string_view) * count);
+    for(isize p = 0; p < count; ++p)
+        patterns[p] = string_view_slice(string_view_of(&words),
+                begin[p], begin[p + 1]);
+
+    double t0 = seconds();
+    string_matcher m;
+    if(string_matcher_init(&m, patterns, count, 0) != 0) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    double t1 = seconds();
+    isize fast = 0;
+    for(int i = 0; i < TEXT_LINES; ++i)
+        fast += string_matcher_run(&m, lines[i], NULL, NULL);
+    double t2 = seconds();
+    // The naive search gets slow fast, so it only sees part of the text
+    int naive_lines = TEXT_LINES;
+    while(naive_lines > 16 && (double)naive_lines * count > 4e6)
+        naive_lines /= 2;
+    isize slow = 0, check = 0;
+    for(int i = 0; i < naive_lines; ++i)
+        slow += naive_count(patterns, count, lines[i]);
+    double t3 = seconds();
+    for(int i = 0; i < naive_lines; ++i)
+        check += string_matcher_run(&m, lines[i], NULL, NULL);
+
+    double mb = (double)TEXT_LINES * LINE_LENGTH / (1 << 20);
+    double naive_mb = (double)naive_lines * LINE_LENGTH / (1 << 20);
+    printf("%6lld patterns: %7d states, built in %8.3f ms, "
+            "matcher %9.2f MB/s (%lld matches), naive %9.2f MB/s%s\n",
+            count, m.state_count, (t1 - t0) * 1e3,
+            mb / (t2 - t1), fast, naive_mb / (t3 - t2),
+            (slow == check) ? "" : " (MISMATCH)");
+
+    string_matcher_free(&m);
+    free(patterns);
+    free(begin);
+    free(words.text);
+}
+
+int main() {
+    string text;
+    string_init(&text);
+    for(int i = 0; i < TEXT_LINES; ++i)
+        random_word(&text, LINE_LENGTH);
+    string_view lines[TEXT_LINES];
+    for(int i = 0; i < TEXT_LINES; ++i)
+        lines[i] = string_view_slice(string_view_of(&text),
+                i * LINE_LENGTH, (i + 1) * LINE_LENGTH);
+    isize counts[] = { 10, 1000, 10000 };
+    for(int i = 0; i < 3; ++i)
+        run(counts[i], lines);
+    free(text.text);
+    return 0;
+}
@@ -27,7 +27,7 @@
 
 if [ "$#" -gt 0 ]; then
   test_suite="tests/$1.c"
-  gcc "$test_suite" -o a.out
+  gcc -pthread "$test_suite" -o a.out
   ./a.out
   rm ./a.out
   exit
@@ -40,7 +40,7 @@ for test_suite in tests/*; do
   else
     echo
   fi
-  gcc "$test_suite" -o a.out
+  gcc -pthread "$test_suite" -o a.out
   ./a.out
 done
 [ -f a.out ] && rm a.out
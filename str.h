@@ -29,6 +29,39 @@ limitations under the License.
 // For python users, the slicing functions work exactly like python slicing.
 // For users of more enlightened languages, foreach macros are provided.
 
+// To search a `string_view` for many patterns at once, build a
+// `string_matcher` from an array of patterns with `string_matcher_init` and
+// pass it to `string_matcher_run`. This is an Aho-Corasick automaton, so the
+// text is scanned only once no matter how many patterns there are. For every
+// occurrence found, the callback gets the index of the pattern in the original
+// array and the offset of the occurrence in the text; returning nonzero from it
+// stops the search. Pass STR_MATCHER_ICASE to ignore ASCII case. The patterns
+// are not referenced after `string_matcher_init` returns. Release the matcher
+// with `string_matcher_free` once you're done with it.
+
+// `string_reader` splits whatever comes out of a file descriptor (stdin, a
+// pipe, a socket) into records ending in a delimiter of your choice, usually
+// '\n'. It needs POSIX, so it is only available if STR_READER is defined before
+// every inclusion of str.h. The data is read in large blocks into a buffer
+// owned by the reader and `string_reader_next` hands out views into it,
+// without copying, that remain valid until the following call. The delimiter
+// is not part of the record; a final record without one is still returned.
+// Only the unfinished record at the end of a block is moved when the next
+// block is read, and the buffer grows if a single record doesn't fit in it.
+// When reading fails, `string_reader_next` returns STR_READER_ERROR with errno
+// set, and calling it again retries the read (useful for EAGAIN on
+// non-blocking descriptors). If STR_READER_THREADS is also defined, passing
+// STR_READER_THREADED to `string_reader_init` starts a thread (pthreads) that
+// reads the next block while you process the current one; the reader must not
+// be moved while that thread runs. Call `string_reader_free` when you're done,
+// even if the thread is blocked waiting for input; the file descriptor is left
+// open.
+
+// All memory is obtained through `string_alloc(ptr, n)`, which works like
+// realloc and defaults to it. If you define your own, you may also define
+// `string_dealloc(ptr)`; otherwise, memory is released with `string_alloc(ptr,
+// 0)`, so your allocator should free the pointer in that case.
+
 #ifndef _STR_H
 #define _STR_H
 
@@ -83,6 +116,67 @@ string_view string_view_trim(string_view sv);
 
 int string_view_eq(string_view sv1, string_view sv2);
 
+#define STR_MATCHER_ICASE 1
+
+typedef struct {
+    int fail, dict, match, depth;
+    int edge_begin, edge_end;
+} string_matcher_state;
+
+typedef struct {
+    unsigned short classes[256];
+    int class_count, state_count, dense_count;
+    int *dense, *edge_target, *pattern_next;
+    unsigned short *edge_class;
+    string_matcher_state *states;
+} string_matcher;
+
+typedef int (*string_match_fn)(void *userdata, isize pattern, isize offset);
+
+int string_matcher_init(string_matcher *m, const string_view *patterns,
+        isize count, int flags);
+isize string_matcher_run(const string_matcher *m, string_view sv,
+        string_match_fn fn, void *userdata);
+void string_matcher_free(string_matcher *m);
+
+#if defined(STR_READER_THREADS) && !defined(STR_READER)
+#define STR_READER
+#endif
+
+#ifdef STR_READER
+
+#ifdef STR_READER_THREADS
+#include <pthread.h>
+#endif // STR_READER_THREADS
+
+typedef struct {
+    string buf;
+    isize pos, scan;
+    int fd, eof;
+    char delim;
+#ifdef STR_READER_THREADS
+    string back;
+    int threaded, back_state, back_errno, release, pending, quit;
+    isize back_result;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif // STR_READER_THREADS
+} string_reader;
+
+// Return values of string_reader_next
+#define STR_READER_END   -1
+#define STR_READER_ERROR -2
+
+#define STR_READER_THREADED 1
+
+int string_reader_init(string_reader *r, int fd, char delim,
+        isize block_size, int flags);
+int string_reader_next(string_reader *r, string_view *record);
+void string_reader_free(string_reader *r);
+
+#endif // STR_READER
+
 #endif // _STR_H
 //------------------------------------------------------------------------------
 #ifdef STR_IMPLEMENTATION
@@ -96,9 +190,20 @@ int string_view_eq(string_view sv1, string_view sv2);
 #ifndef string_alloc
 #include <stdlib.h>
 #define string_alloc(ptr, n) \
-    (char*)realloc((ptr), (n) * sizeof(char));
+    (char*)realloc((ptr), (n) * sizeof(char))
+#ifndef string_dealloc
+#define string_dealloc(ptr) free(ptr)
+#endif // string_dealloc
 #endif // string_alloc
 
+#ifndef string_dealloc
+#define string_dealloc(ptr) string_alloc((ptr), 0)
+#endif // string_dealloc
+
+#ifndef STR_MATCHER_DENSE_SIZE
+#define STR_MATCHER_DENSE_SIZE 32768
+#endif // STR_MATCHER_DENSE_SIZE
+
 void string_init(string *s) {
     s->capacity = s->length = 0;
     s->text = NULL;
@@ -220,7 +325,448 @@ int string_view_eq(string_view sv1, string_view sv2) {
     return memcmp(sv1.text, sv2.text, sv1.length) == 0;
 }
 
+//------------------------------------------------------------------------------
+
+// The automaton works on byte classes rather than bytes: every byte that shows
+// up in some pattern gets a class of its own (shared by both cases with
+// STR_MATCHER_ICASE), and all other bytes go in class 0, which always leads
+// back to the root. States are numbered in breadth-first order, so the
+// shallow states, which is where the search spends most of its time, come
+// first. Those get a dense row with a transition for every class, as long as
+// the rows fit in STR_MATCHER_DENSE_SIZE entries; the deeper states only store
+// their own edges and fall back on their failure links.
+
+// Only ASCII letters are folded, whatever the locale says
+static unsigned char _string_matcher_fold(unsigned char ch, int flags) {
+    if((flags & STR_MATCHER_ICASE) && ch >= 'A' && ch <= 'Z')
+        return ch - 'A' + 'a';
+    return ch;
+}
+
+static int _string_matcher_child(const int *first, const int *next,
+        const int *cls, int node, int c) {
+    int v = first[node];
+    while(v >= 0 && cls[v] != c) v = next[v];
+    return v;
+}
+
+int string_matcher_init(string_matcher *m, const string_view *patterns,
+        isize count, int flags) {
+    isize total = 0;
+    int used[256] = {0};
+    memset(m, 0, sizeof(*m));
+    for(isize i = 0; i < count; ++i) {
+        total += patterns[i].length;
+        for(isize j = 0; j < patterns[i].length; ++j)
+            used[_string_matcher_fold(patterns[i].text[j], flags)] = 1;
+    }
+    m->class_count = 1;
+    for(int b = 0; b < 256; ++b)
+        if(used[b]) m->classes[b] = m->class_count++;
+    for(int b = 0; b < 256; ++b)
+        m->classes[b] = m->classes[_string_matcher_fold(b, flags)];
+
+    // Build the trie. Each node but the root has exactly one incoming edge, so
+    // the edges are indexed by the node they lead to
+    isize n = total + 1;
+    int *tmp = (int*)string_alloc(NULL, sizeof(int) * 9 * n);
+    m->pattern_next = (int*)string_alloc(NULL, sizeof(int) * (count + 1));
+    if(tmp == NULL || m->pattern_next == NULL) goto nomem;
+    int *first = tmp, *next = tmp + n, *cls = tmp + 2 * n;
+    int *match = tmp + 3 * n, *depth = tmp + 4 * n, *fail = tmp + 5 * n;
+    int *dict = tmp + 6 * n, *order = tmp + 7 * n, *renum = tmp + 8 * n;
+    first[0] = match[0] = -1;
+    depth[0] = 0;
+    m->state_count = 1;
+    for(isize i = 0; i < count; ++i) {
+        int s = 0;
+        for(isize j = 0; j < patterns[i].length; ++j) {
+            int c = m->classes[(unsigned char)patterns[i].text[j]];
+            int v = _string_matcher_child(first, next, cls, s, c);
+            if(v < 0) {
+                v = m->state_count++;
+                first[v] = match[v] = -1;
+                cls[v] = c;
+                depth[v] = depth[s] + 1;
+                next[v] = first[s];
+                first[s] = v;
+            }
+            s = v;
+        }
+        m->pattern_next[i] = -1;
+        if(s == 0) continue; // empty patterns never match
+        m->pattern_next[i] = match[s];
+        match[s] = (int)i;
+    }
+
+    // Failure and dictionary links, in breadth-first order
+    int head = 0, tail = 1;
+    order[0] = fail[0] = dict[0] = 0;
+    while(head < tail) {
+        int u = order[head++];
+        for(int v = first[u]; v >= 0; v = next[v]) {
+            order[tail++] = v;
+            fail[v] = 0;
+            for(int f = fail[u]; u != 0; f = fail[f]) {
+                int w = _string_matcher_child(first, next, cls, f, cls[v]);
+                if(w >= 0) {
+                    fail[v] = w;
+                    break;
+                }
+                if(f == 0) break;
+            }
+            dict[v] = (match[fail[v]] >= 0) ? fail[v] : dict[fail[v]];
+        }
+    }
+    for(int i = 0; i < m->state_count; ++i)
+        renum[order[i]] = i;
+
+    // Lay out the final automaton
+    m->dense_count = STR_MATCHER_DENSE_SIZE / m->class_count;
+    if(m->dense_count < 1) m->dense_count = 1;
+    if(m->dense_count > m->state_count) m->dense_count = m->state_count;
+    m->states = (string_matcher_state*)string_alloc(NULL,
+            sizeof(string_matcher_state) * m->state_count);
+    m->dense = (int*)string_alloc(NULL,
+            sizeof(int) * m->dense_count * m->class_count);
+    m->edge_class = (unsigned short*)string_alloc(NULL,
+            sizeof(unsigned short) * m->state_count);
+    m->edge_target = (int*)string_alloc(NULL,
+            sizeof(int) * m->state_count);
+    if(m->states == NULL || m->dense == NULL
+            || m->edge_class == NULL || m->edge_target == NULL)
+        goto nomem;
+    int e = 0;
+    for(int i = 0; i < m->state_count; ++i) {
+        int u = order[i];
+        string_matcher_state *st = &m->states[i];
+        st->fail = renum[fail[u]];
+        st->dict = renum[dict[u]];
+        st->match = match[u];
+        st->depth = depth[u];
+        st->edge_begin = st->edge_end = e;
+        if(i >= m->dense_count) {
+            for(int v = first[u]; v >= 0; v = next[v]) {
+                m->edge_class[e] = (unsigned short)cls[v];
+                m->edge_target[e++] = renum[v];
+            }
+            st->edge_end = e;
+            continue;
+        }
+        // The failure state is shallower, so its row is already complete
+        int *row = &m->dense[i * m->class_count];
+        for(int c = 0; c < m->class_count; ++c)
+            row[c] = (i == 0) ? 0 : m->dense[st->fail * m->class_count + c];
+        for(int v = first[u]; v >= 0; v = next[v])
+            row[cls[v]] = renum[v];
+    }
+    string_dealloc(tmp);
+    return 0;
+nomem:
+    if(tmp != NULL) string_dealloc(tmp);
+    string_matcher_free(m);
+    return -1;
+}
+
+static inline int _string_matcher_step(const string_matcher *m, int s, int c) {
+    while(s >= m->dense_count) {
+        const string_matcher_state *st = &m->states[s];
+        for(int e = st->edge_begin; e < st->edge_end; ++e)
+            if(m->edge_class[e] == c) return m->edge_target[e];
+        s = st->fail;
+    }
+    return m->dense[s * m->class_count + c];
+}
+
+isize string_matcher_run(const string_matcher *m, string_view sv,
+        string_match_fn fn, void *userdata) {
+    isize found = 0;
+    int s = 0;
+    for(isize i = 0; i < sv.length; ++i) {
+        int c = m->classes[(unsigned char)sv.text[i]];
+        if(c == 0) {
+            s = 0;
+            continue;
+        }
+        s = _string_matcher_step(m, s, c);
+        int t = (m->states[s].match >= 0) ? s : m->states[s].dict;
+        for(; t != 0; t = m->states[t].dict) {
+            isize offset = i + 1 - m->states[t].depth;
+            for(int p = m->states[t].match; p >= 0; p = m->pattern_next[p]) {
+                found += 1;
+                if(fn != NULL && fn(userdata, p, offset)) return found;
+            }
+        }
+    }
+    return found;
+}
+
+void string_matcher_free(string_matcher *m) {
+    if(m->states != NULL) string_dealloc(m->states);
+    if(m->dense != NULL) string_dealloc(m->dense);
+    if(m->edge_class != NULL) string_dealloc(m->edge_class);
+    if(m->edge_target != NULL) string_dealloc(m->edge_target);
+    if(m->pattern_next != NULL) string_dealloc(m->pattern_next);
+    memset(m, 0, sizeof(*m));
+}
+
+//------------------------------------------------------------------------------
+#ifdef STR_READER
+
+#include <errno.h>
+#include <unistd.h>
+
+#define STR_READER_BACK_IDLE    0
+#define STR_READER_BACK_FILLING 1
+#define STR_READER_BACK_FILLED  2
+
+static isize _string_reader_read(int fd, string *s, isize offset) {
+    isize n;
+    do n = read(fd, s->text + offset, s->capacity - 1 - offset);
+    while(n < 0 && errno == EINTR);
+    if(n < 0) return n;
+    s->length = offset + n;
+    s->text[s->length] = '\0';
+    return n;
+}
+
+// Tries to find a whole record in the buffer, resuming the search from where
+// the last one gave up
+static int _string_reader_take(string_reader *r, string_view *record) {
+    char *end = memchr(r->buf.text + r->scan, r->delim,
+            r->buf.length - r->scan);
+    if(end == NULL) {
+        r->scan = r->buf.length;
+        return 0;
+    }
+    record->text = r->buf.text + r->pos;
+    record->length = end - record->text;
+    r->pos = r->scan = end - r->buf.text + 1;
+    return 1;
+}
+
+static int _string_reader_rest(string_reader *r, string_view *record) {
+    if(r->pos == r->buf.length) return STR_READER_END;
+    record->text = r->buf.text + r->pos;
+    record->length = r->buf.length - r->pos;
+    r->pos = r->scan = r->buf.length;
+    return 0;
+}
+
+// Moves the unfinished record to the start of the buffer and makes room for at
+// least `extra` more bytes after it. If the buffer can't grow, it is left as it
+// was, so that the caller can try again later
+static int _string_reader_compact(string_reader *r, isize extra) {
+    isize left = r->buf.length - r->pos;
+    if(r->pos > 0) {
+        memmove(r->buf.text, r->buf.text + r->pos, left);
+        r->buf.length = left;
+        r->scan -= r->pos;
+        r->pos = 0;
+    }
+    if(left + extra + 1 > r->buf.capacity) {
+        isize capacity = r->buf.capacity;
+        while(capacity < left + extra + 1)
+            capacity *= 2;
+        char *text = string_alloc(r->buf.text, capacity);
+        if(text == NULL) {
+            errno = ENOMEM;
+            return STR_READER_ERROR;
+        }
+        r->buf.text = text;
+        r->buf.capacity = capacity;
+    }
+    return 0;
+}
+
+#ifdef STR_READER_THREADS
+
+// The background thread only touches `back`, and only while it is FILLING.
+// It can only be cancelled while it is blocked in read, when it holds nothing
+static void *_string_reader_thread(void *userdata) {
+    string_reader *r = userdata;
+    int cancel_state;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+    pthread_mutex_lock(&r->lock);
+    for(;;) {
+        while(r->back_state != STR_READER_BACK_FILLING && !r->quit)
+            pthread_cond_wait(&r->cond, &r->lock);
+        if(r->quit) break;
+        pthread_mutex_unlock(&r->lock);
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &cancel_state);
+        isize n = _string_reader_read(r->fd, &r->back, 0);
+        int err = errno;
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+        pthread_mutex_lock(&r->lock);
+        r->back_result = n;
+        r->back_errno = err;
+        r->back_state = STR_READER_BACK_FILLED;
+        pthread_cond_broadcast(&r->cond);
+        if(n == 0) break; // nothing more to read
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+static void _string_reader_request(string_reader *r) {
+    pthread_mutex_lock(&r->lock);
+    r->back_state = STR_READER_BACK_FILLING;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static int _string_reader_wait(string_reader *r) {
+    pthread_mutex_lock(&r->lock);
+    while(r->back_state != STR_READER_BACK_FILLED)
+        pthread_cond_wait(&r->cond, &r->lock);
+    r->back_state = STR_READER_BACK_IDLE;
+    isize n = r->back_result;
+    pthread_mutex_unlock(&r->lock);
+    if(n < 0) {
+        errno = r->back_errno;
+        return STR_READER_ERROR;
+    }
+    if(n == 0) r->eof = 1;
+    return 0;
+}
+
+static void _string_reader_swap(string_reader *r) {
+    string tmp = r->buf;
+    r->buf = r->back;
+    r->back = tmp;
+    r->pos = r->scan = 0;
+}
+
+static int _string_reader_next_threaded(string_reader *r,
+        string_view *record) {
+    if(r->release) {
+        // Either the last record lived in the back buffer or the last read
+        // failed; in both cases, the back buffer is free to be filled again
+        r->release = 0;
+        if(!r->eof) _string_reader_request(r);
+    }
+    for(;;) {
+        if(_string_reader_take(r, record)) return 0;
+        if(r->eof) return _string_reader_rest(r, record);
+        // A block that couldn't be stitched last time is still in `back`
+        if(!r->pending) {
+            if(_string_reader_wait(r) != 0) {
+                r->release = 1;
+                return STR_READER_ERROR;
+            }
+            if(r->eof) continue;
+        }
+        r->pending = 0;
+        if(r->pos == r->buf.length) {
+            _string_reader_swap(r);
+            _string_reader_request(r);
+            continue;
+        }
+        // A record straddles the two blocks, so the part of it that is in the
+        // new block gets copied after the part that is in the current one
+        char *end = memchr(r->back.text, r->delim, r->back.length);
+        isize head = (end != NULL) ? end - r->back.text : r->back.length;
+        if(_string_reader_compact(r, head) != 0) {
+            r->pending = 1;
+            return STR_READER_ERROR;
+        }
+        memcpy(r->buf.text + r->buf.length, r->back.text, head);
+        r->buf.length += head;
+        r->buf.text[r->buf.length] = '\0';
+        r->scan = r->buf.length;
+        if(end == NULL) {
+            _string_reader_request(r);
+            continue;
+        }
+        record->text = r->buf.text;
+        record->length = r->buf.length;
+        _string_reader_swap(r);
+        r->pos = r->scan = head + 1;
+        r->release = 1;
+        return 0;
+    }
+}
+
+#endif // STR_READER_THREADS
+
+int string_reader_init(string_reader *r, int fd, char delim,
+        isize block_size, int flags) {
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->delim = delim;
+    if(block_size < 2) block_size = 2;
+    string_init_with_capacity(&r->buf, block_size);
+    if(r->buf.text == NULL) return STR_READER_ERROR;
+#ifdef STR_READER_THREADS
+    if(!(flags & STR_READER_THREADED)) return 0;
+    string_init_with_capacity(&r->back, block_size);
+    if(r->back.text == NULL) goto nothread;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    r->back_state = STR_READER_BACK_FILLING;
+    if(pthread_create(&r->thread, NULL, _string_reader_thread, r) != 0) {
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->cond);
+        goto nothread;
+    }
+    r->threaded = 1;
+    return 0;
+nothread:
+    if(r->back.text != NULL) string_dealloc(r->back.text);
+    string_dealloc(r->buf.text);
+    memset(r, 0, sizeof(*r));
+    return STR_READER_ERROR;
+#else
+    (void)flags;
+    return 0;
+#endif // STR_READER_THREADS
+}
+
+int string_reader_next(string_reader *r, string_view *record) {
+#ifdef STR_READER_THREADS
+    if(r->threaded) return _string_reader_next_threaded(r, record);
+#endif // STR_READER_THREADS
+    for(;;) {
+        if(_string_reader_take(r, record)) return 0;
+        if(r->eof) return _string_reader_rest(r, record);
+        // Read right after the unfinished record, growing the buffer if the
+        // record already takes more than half of it
+        if(_string_reader_compact(r, r->buf.capacity / 2) != 0)
+            return STR_READER_ERROR;
+        isize n = _string_reader_read(r->fd, &r->buf, r->buf.length);
+        if(n < 0) return STR_READER_ERROR;
+        if(n == 0) r->eof = 1;
+    }
+}
+
+void string_reader_free(string_reader *r) {
+#ifdef STR_READER_THREADS
+    if(r->threaded) {
+        // The thread may be blocked in read on a descriptor that won't get
+        // any more data, so it is cancelled rather than waited for
+        pthread_mutex_lock(&r->lock);
+        r->quit = 1;
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+        pthread_cancel(r->thread);
+        pthread_join(r->thread, NULL);
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->cond);
+    }
+    if(r->back.text != NULL) string_dealloc(r->back.text);
+#endif // STR_READER_THREADS
+    if(r->buf.text != NULL) string_dealloc(r->buf.text);
+    memset(r, 0, sizeof(*r));
+}
+
+#undef STR_READER_BACK_IDLE
+#undef STR_READER_BACK_FILLING
+#undef STR_READER_BACK_FILLED
+#endif // STR_READER
+
 #undef string_alloc
+#undef string_dealloc
 #undef STR_BASE_SIZE
+#undef STR_MATCHER_DENSE_SIZE
 #endif // STR_IMPLEMENTATION
 // vim: set ft=c :
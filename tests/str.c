@@ -1,7 +1,26 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+// Allocations fail while this is positive, each failure decrementing it
+static int alloc_failures = 0;
+
+static char *test_alloc(void *ptr, long long n) {
+    if(n == 0) {
+        free(ptr);
+        return NULL;
+    }
+    if(alloc_failures > 0) {
+        alloc_failures -= 1;
+        return NULL;
+    }
+    return realloc(ptr, n);
+}
+
+#define string_alloc(ptr, n) test_alloc((ptr), (n))
+#define STR_READER_THREADS
 #define STR_IMPLEMENTATION
 #include "../str.h"
 
@@ -66,12 +85,234 @@ int test_slice(void *u) {
     return TEST_RESULT_OK;
 }
 
+typedef struct {
+    isize patterns[16], offsets[16];
+    int count;
+} match_log;
+
+int log_match(void *userdata, isize pattern, isize offset) {
+    match_log *log = userdata;
+    log->patterns[log->count] = pattern;
+    log->offsets[log->count] = offset;
+    log->count += 1;
+    return log->count == 16;
+}
+
+int test_matcher(void *u) {
+    string_view patterns[] = {
+        string_view_from_cstr("he"),
+        string_view_from_cstr("she"),
+        string_view_from_cstr("his"),
+        string_view_from_cstr("hers"),
+    };
+    string_matcher m;
+    if(string_matcher_init(&m, patterns, 4, 0) != 0)
+        return TEST_RESULT_HARD_FAIL;
+    match_log log = {0};
+    string_view text = string_view_from_cstr("ushers his");
+    isize found = string_matcher_run(&m, text, log_match, &log);
+    string_matcher_free(&m);
+
+    // Occurrences come out in the order in which they end, longest first
+    isize expected_patterns[] = { 1, 0, 3, 2 };
+    isize expected_offsets[] = { 1, 2, 2, 7 };
+    if(found != 4 || log.count != 4) return TEST_RESULT_FAIL;
+    for(int i = 0; i < 4; ++i) {
+        if(log.patterns[i] != expected_patterns[i]
+                || log.offsets[i] != expected_offsets[i])
+            return TEST_RESULT_FAIL;
+    }
+    return TEST_RESULT_OK;
+}
+
+int test_matcher_icase(void *u) {
+    string_view patterns[] = {
+        string_view_from_cstr("error"),
+        string_view_from_cstr("Timeout"),
+        string_view_from_cstr(""),
+        string_view_from_cstr("error"),
+    };
+    string_matcher m;
+    if(string_matcher_init(&m, patterns, 4, STR_MATCHER_ICASE) != 0)
+        return TEST_RESULT_HARD_FAIL;
+    match_log log = {0};
+    string_view text = string_view_from_cstr("ERROR: timeout, Error!");
+    isize found = string_matcher_run(&m, text, log_match, &log);
+    isize none = string_matcher_run(&m, string_view_from_cstr("errr"),
+            NULL, NULL);
+    string_matcher_free(&m);
+    // Duplicate patterns are reported separately, empty ones never
+    if(found != 5 || none != 0) return TEST_RESULT_FAIL;
+    if(log.offsets[0] != 0 || log.offsets[1] != 0
+            || log.patterns[2] != 1 || log.offsets[2] != 7
+            || log.offsets[3] != 16 || log.offsets[4] != 16)
+        return TEST_RESULT_FAIL;
+    return TEST_RESULT_OK;
+}
+
+int check_reader(int flags, isize block_size) {
+    // Records of every length, some longer than a whole block, plus an empty
+    // one and a last one without the delimiter
+    string input;
+    string_init(&input);
+    for(int i = 0; i < 200; ++i) {
+        for(int j = 0; j < i % 37; ++j)
+            string_push(&input, 'a' + (i + j) % 26);
+        string_push(&input, ';');
+    }
+    string_push(&input, ';');
+    string_concat(&input, string_view_from_cstr("last"));
+
+    int fds[2];
+    if(pipe(fds) != 0) return TEST_RESULT_SKIP;
+    if(write(fds[1], input.text, input.length) != input.length)
+        return TEST_RESULT_SKIP;
+    close(fds[1]);
+
+    int status = TEST_RESULT_OK;
+    string_reader r;
+    string_view record;
+    if(string_reader_init(&r, fds[0], ';', block_size, flags) != 0)
+        return TEST_RESULT_HARD_FAIL;
+    string_view expected = string_view_of(&input);
+    isize at = 0;
+    while(string_reader_next(&r, &record) == 0) {
+        isize end = at;
+        while(end < expected.length && expected.text[end] != ';')
+            end += 1;
+        if(!string_view_eq(record, string_view_slice(expected, at, end))) {
+            status = TEST_RESULT_FAIL;
+            break;
+        }
+        at = end + 1;
+    }
+    if(at != expected.length + 1) status = TEST_RESULT_FAIL;
+    string_reader_free(&r);
+    close(fds[0]);
+    free(input.text);
+    return status;
+}
+
+int test_reader(void *u) {
+    int status = check_reader(0, 16);
+    if(status != TEST_RESULT_OK) return status;
+    return check_reader(0, 4096);
+}
+
+int test_reader_threaded(void *u) {
+    int status = check_reader(STR_READER_THREADED, 16);
+    if(status != TEST_RESULT_OK) return status;
+    return check_reader(STR_READER_THREADED, 4096);
+}
+
+int test_reader_free_blocked(void *u) {
+    // The writer end stays open, so the thread is left waiting for more input
+    int fds[2];
+    if(pipe(fds) != 0) return TEST_RESULT_SKIP;
+    if(write(fds[1], "first;second", 12) != 12) return TEST_RESULT_SKIP;
+    string_reader r;
+    string_view record;
+    if(string_reader_init(&r, fds[0], ';', 64, STR_READER_THREADED) != 0)
+        return TEST_RESULT_HARD_FAIL;
+    int status = TEST_RESULT_OK;
+    if(string_reader_next(&r, &record) != 0
+            || !string_view_eq(record, string_view_from_cstr("first")))
+        status = TEST_RESULT_FAIL;
+    string_reader_free(&r);
+    close(fds[0]);
+    close(fds[1]);
+    return status;
+}
+
+int check_reader_retry(int flags) {
+    int fds[2];
+    if(pipe(fds) != 0) return TEST_RESULT_SKIP;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    string_reader r;
+    string_view record;
+    if(string_reader_init(&r, fds[0], ';', 64, flags) != 0)
+        return TEST_RESULT_HARD_FAIL;
+    int status = TEST_RESULT_OK;
+    if(string_reader_next(&r, &record) != STR_READER_ERROR || errno != EAGAIN)
+        status = TEST_RESULT_FAIL;
+    if(write(fds[1], "ready;", 6) != 6) status = TEST_RESULT_SKIP;
+    close(fds[1]);
+    // The thread might not have read the new data yet, so keep retrying
+    int result;
+    while((result = string_reader_next(&r, &record)) == STR_READER_ERROR
+            && errno == EAGAIN);
+    if(result != 0 || !string_view_eq(record, string_view_from_cstr("ready")))
+        status = TEST_RESULT_FAIL;
+    if(string_reader_next(&r, &record) != STR_READER_END)
+        status = TEST_RESULT_FAIL;
+    string_reader_free(&r);
+    close(fds[0]);
+    return status;
+}
+
+int test_reader_retry(void *u) {
+    int status = check_reader_retry(0);
+    if(status != TEST_RESULT_OK) return status;
+    return check_reader_retry(STR_READER_THREADED);
+}
+
+int check_reader_nomem(int flags) {
+    // A record much longer than a block forces the buffer to grow
+    string input;
+    string_init(&input);
+    for(int i = 0; i < 600; ++i)
+        string_push(&input, 'a' + i % 26);
+    string_concat(&input, string_view_from_cstr(";tail;"));
+    string_view long_record = string_view_slice(string_view_of(&input), 0, 600);
+
+    int fds[2];
+    if(pipe(fds) != 0) return TEST_RESULT_SKIP;
+    if(write(fds[1], input.text, input.length) != input.length)
+        return TEST_RESULT_SKIP;
+    close(fds[1]);
+
+    int status = TEST_RESULT_OK;
+    string_reader r;
+    string_view record;
+    if(string_reader_init(&r, fds[0], ';', 64, flags) != 0)
+        return TEST_RESULT_HARD_FAIL;
+    alloc_failures = 1;
+    if(string_reader_next(&r, &record) != STR_READER_ERROR || errno != ENOMEM)
+        status = TEST_RESULT_FAIL;
+    alloc_failures = 0;
+    if(string_reader_next(&r, &record) != 0
+            || !string_view_eq(record, long_record))
+        status = TEST_RESULT_FAIL;
+    if(string_reader_next(&r, &record) != 0
+            || !string_view_eq(record, string_view_from_cstr("tail")))
+        status = TEST_RESULT_FAIL;
+    if(string_reader_next(&r, &record) != STR_READER_END)
+        status = TEST_RESULT_FAIL;
+    string_reader_free(&r);
+    close(fds[0]);
+    free(input.text);
+    return status;
+}
+
+int test_reader_nomem(void *u) {
+    int status = check_reader_nomem(0);
+    if(status != TEST_RESULT_OK) return status;
+    return check_reader_nomem(STR_READER_THREADED);
+}
+
 int main() {
     test_info suite[] = {
         { .name = "concat", .fn = test_concat, .should_fail = 0 },
         { .name = "string_build", .fn = test_string_build, .should_fail = 0 },
         { .name = "trim", .fn = test_trim, .should_fail = 0 },
         { .name = "slice", .fn = test_slice, .should_fail = 0 },
+        { .name = "matcher", .fn = test_matcher, .should_fail = 0 },
+        { .name = "matcher_icase", .fn = test_matcher_icase, .should_fail = 0 },
+        { .name = "reader", .fn = test_reader, .should_fail = 0 },
+        { .name = "reader_threaded", .fn = test_reader_threaded, .should_fail = 0 },
+        { .name = "reader_free_blocked", .fn = test_reader_free_blocked, .should_fail = 0 },
+        { .name = "reader_retry", .fn = test_reader_retry, .should_fail = 0 },
+        { .name = "reader_nomem", .fn = test_reader_nomem, .should_fail = 0 },
         END_OF_SUITE
     };
     return test_suite_run("str", suite, NULL);